@@ -1,6 +1,6 @@
 #include "MainWindow.h"
 #include "ui_MainWindow.h"
-#include "CurlEasy.h"
+#include "CurlResumableDownload.h"
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -8,13 +8,14 @@ MainWindow::MainWindow(QWidget *parent) :
 {
     ui->setupUi(this);
 
-    // Create CurlEasy and connect signals.
+    // Create the download and connect signals.
     // Since curl_easy handles could be reused freely we can do it only once
-    transfer = new CurlEasy(this); // Parent it so it will be destroyed automatically
+    transfer = new CurlResumableDownload(this); // Parent it so it will be destroyed automatically
 
-    connect(transfer, &CurlEasy::done, this, &MainWindow::onTransferDone);
-    connect(transfer, &CurlEasy::aborted, this, &MainWindow::onTransferAborted);
-    connect(transfer, &CurlEasy::progress, this, &MainWindow::onTransferProgress);
+    connect(transfer, &CurlResumableDownload::done, this, &MainWindow::onTransferDone);
+    connect(transfer, &CurlResumableDownload::aborted, this, &MainWindow::onTransferAborted);
+    connect(transfer, &CurlResumableDownload::restarted, this, &MainWindow::onTransferRestarted);
+    connect(transfer, &CurlResumableDownload::progress, this, &MainWindow::onTransferProgress);
 }
 
 MainWindow::~MainWindow()
@@ -33,20 +34,9 @@ void MainWindow::on_startStopButton_clicked()
     ui->transferLog->clear();
     ui->progressBar->setValue(0);
 
-    // Prepare target file
-    downloadFile = new QFile(ui->fileNameEdit->text());
-    if (!downloadFile->open(QIODevice::WriteOnly)) {
-        log("Failed to open file for writing.");
-        delete downloadFile;
-        downloadFile = nullptr;
-        return;
-    }
-
-    // Set a simple file writing function
-    transfer->setWriteFunction([this](char *data, size_t size)->size_t {
-        qint64 bytesWritten = downloadFile->write(data, static_cast<qint64>(size));
-        return static_cast<size_t>(bytesWritten);
-    });
+    // Partially downloaded file is continued from where it stopped last time
+    transfer->setFileName(ui->fileNameEdit->text());
+    transfer->setUrl(QUrl(ui->urlEdit->text()));
 
     // Print headers to the transfer log box
     transfer->setHeaderFunction([this](char *data, size_t size)->size_t {
@@ -54,21 +44,20 @@ void MainWindow::on_startStopButton_clicked()
         return size;
     });
 
-    transfer->set(CURLOPT_URL, QUrl(ui->urlEdit->text()));
-    transfer->set(CURLOPT_FOLLOWLOCATION, long(1)); // Follow redirects
-    transfer->set(CURLOPT_FAILONERROR, long(1)); // Do not return CURL_OK in case valid server responses reporting errors.
+    transfer->transfer()->set(CURLOPT_FOLLOWLOCATION, long(1)); // Follow redirects
+    transfer->transfer()->set(CURLOPT_FAILONERROR, long(1)); // Do not return CURL_OK in case valid server responses reporting errors.
 
     ui->startStopButton->setText("Abort");
     log("Transfer started.");
 
     transfer->perform();
+
+    if (transfer->isRunning() && transfer->resumedFrom() > 0)
+        log(QString("Resuming from %1 bytes.").arg(transfer->resumedFrom()));
 }
 
-void MainWindow::onTransferProgress(qint64 downloadTotal, qint64 downloadNow, qint64 uploadTotal, qint64 uploadNow)
+void MainWindow::onTransferProgress(qint64 downloadNow, qint64 downloadTotal)
 {
-    Q_UNUSED(uploadTotal);
-    Q_UNUSED(uploadNow);
-
     if (downloadTotal > 0) {
         if (downloadNow > downloadTotal) downloadNow = downloadTotal;
         qint64 progress = (downloadNow * ui->progressBar->maximum())/downloadTotal;
@@ -81,33 +70,32 @@ void MainWindow::onTransferProgress(qint64 downloadTotal, qint64 downloadNow, qi
 void MainWindow::onTransferDone()
 {
     if (transfer->result() != CURLE_OK) {
-        log(QString("Transfer failed with curl error '%1'")
-                    .arg(curl_easy_strerror(transfer->result())));
-        downloadFile->remove();
+        // Keep the file, next Start continues it
+        log(QString("Transfer failed: %1. %2 bytes kept for resuming.")
+                    .arg(transfer->errorString())
+                    .arg(transfer->bytesCommitted()));
     } else {
         log(QString("Transfer complete. %1 bytes downloaded.")
-                    .arg(downloadFile->size()));
+                    .arg(transfer->bytesWritten()));
         ui->progressBar->setValue(ui->progressBar->maximum());
     }
 
-    delete downloadFile;
-    downloadFile = nullptr;
-
     ui->startStopButton->setText("Start");
 }
 
 void MainWindow::onTransferAborted()
 {
-    log(QString("Transfer aborted. %1 bytes downloaded.")
-        .arg(downloadFile->size()));
-
-    downloadFile->remove();
-    delete downloadFile;
-    downloadFile = nullptr;
+    log(QString("Transfer aborted. %1 bytes kept for resuming.")
+        .arg(transfer->bytesCommitted()));
 
     ui->startStopButton->setText("Start");
 }
 
+void MainWindow::onTransferRestarted()
+{
+    log("File has changed on the server, starting over.");
+}
+
 void MainWindow::log(QString text)
 {
     // Remove extra newlines for headers to be printed neatly
@@ -7,8 +7,7 @@ namespace Ui {
 class MainWindow;
 }
 
-class QFile;
-class CurlEasy;
+class CurlResumableDownload;
 
 class MainWindow : public QMainWindow
 {
@@ -20,17 +19,17 @@ public:
 
 private slots:
     void on_startStopButton_clicked();
-    void onTransferProgress(qint64 downloadTotal, qint64 downloadNow, qint64 uploadTotal, qint64 uploadNow);
+    void onTransferProgress(qint64 downloadNow, qint64 downloadTotal);
     void onTransferDone();
     void onTransferAborted();
+    void onTransferRestarted();
 
 private:
     void log(QString text);
 
     Ui::MainWindow *ui;
 
-    CurlEasy *transfer = nullptr;
-    QFile *downloadFile = nullptr;
+    CurlResumableDownload *transfer = nullptr;
 };
 
 #endif // MAINWINDOW_H
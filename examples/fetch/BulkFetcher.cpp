@@ -0,0 +1,432 @@
+#include "BulkFetcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTimer>
+#include "CurlEasy.h"
+
+// Partial files are hashed in slices so that resuming a huge one doesn't stall other transfers
+static const qint64 hashSliceSize = 4*1024*1024;
+
+struct BulkFetcher::Job
+{
+    CurlEasy *transfer = nullptr;
+    ManifestEntry entry;
+    QFile file;
+    QFile partial; // Open while bytes already on disk are being hashed
+    QByteArray buffer;
+    std::unique_ptr<QCryptographicHash> hash;
+    QString error;
+    QByteArray validator; // Sent as If-Range when resuming
+    QByteArray responseEtag;
+    QByteArray responseLastModified;
+    qint64 resumeFrom = 0;
+    qint64 contentRangeStart = -1;
+    qint64 contentRangeTotal = -1;
+    bool bodyChecked = false;
+    bool discardBody = false;
+    bool restarted = false;
+};
+
+BulkFetcher::BulkFetcher(QObject *parent)
+    : QObject(parent)
+    , reportTimer_(new QTimer(this))
+{
+    connect(reportTimer_, &QTimer::timeout, this, &BulkFetcher::report);
+    connect(&manifest_, &ManifestReader::readyRead, this, &BulkFetcher::onManifestReadyRead);
+}
+
+BulkFetcher::~BulkFetcher()
+{
+    // Transfers call back into jobs, so get rid of them before the jobs go away
+    for (auto &job : jobs_)
+        delete job->transfer;
+}
+
+void BulkFetcher::start()
+{
+    if (running_)
+        return;
+
+    running_ = true;
+    elapsed_.start();
+    lastReportTime_ = 0;
+    lastReportBytes_ = bytesReceived_;
+
+    if (reportInterval_ > 0)
+        reportTimer_->start(reportInterval_);
+
+    while (static_cast<int>(jobs_.size()) < concurrency_) {
+        std::unique_ptr<Job> job(new Job);
+        Job *jobPtr = job.get();
+
+        // Handles are reused for every entry this slot picks up
+        job->transfer = new CurlEasy(this);
+        job->transfer->set(CURLOPT_FOLLOWLOCATION, long(1));
+        job->transfer->setWriteFunction([this, jobPtr](char *data, size_t size)->size_t {
+            return onWriteData(jobPtr, data, size);
+        });
+        job->transfer->setHeaderFunction([this, jobPtr](char *data, size_t size)->size_t {
+            return onHeaderData(jobPtr, data, size);
+        });
+        connect(job->transfer, &CurlEasy::done, this, [this, jobPtr](CURLcode result) {
+            onJobDone(jobPtr, result);
+        });
+
+        jobs_.push_back(std::move(job));
+    }
+
+    for (auto &job : jobs_) {
+        activeJobs_++;
+        startNext(job.get());
+    }
+}
+
+void BulkFetcher::startNext(Job *job)
+{
+    ManifestEntry entry;
+    QString error;
+
+    while (true) {
+        ManifestReader::Status status = manifest_.readNext(&entry, &error);
+        if (status == ManifestReader::Pending) {
+            // Slot stays active and picks up the entry once it arrives
+            waitingJobs_.push_back(job);
+            return;
+        }
+        if (status == ManifestReader::End)
+            break;
+
+        if (error.isEmpty()) {
+            job->entry = entry;
+            job->restarted = false;
+            if (openDestination(job, true, &error)) {
+                launch(job);
+                return;
+            }
+        }
+        failEntry(entry, error);
+    }
+
+    // Manifest is exhausted, this slot stays idle
+    activeJobs_--;
+    if (activeJobs_ == 0 && running_) {
+        running_ = false;
+        reportTimer_->stop();
+        report();
+        emit finished();
+    }
+}
+
+void BulkFetcher::onManifestReadyRead()
+{
+    // Slots still short of input put themselves back
+    std::vector<Job*> jobs;
+    jobs.swap(waitingJobs_);
+    for (Job *job : jobs)
+        startNext(job);
+}
+
+void BulkFetcher::launch(Job *job)
+{
+    if (job->partial.isOpen()) {
+        hashPartial(job);
+        return;
+    }
+
+    job->error.clear();
+    job->contentRangeStart = -1;
+    job->contentRangeTotal = -1;
+    job->bodyChecked = false;
+    job->discardBody = false;
+
+    job->transfer->set(CURLOPT_URL, job->entry.url);
+    job->transfer->set(CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(job->resumeFrom));
+
+    // Server answers with the whole entity if it has changed since the partial file was written
+    if (job->resumeFrom > 0 && !job->validator.isEmpty())
+        job->transfer->setHttpHeaderRaw("If-Range", job->validator);
+    else if (job->transfer->hasHttpHeader("If-Range"))
+        job->transfer->removeHttpHeader("If-Range");
+
+    job->transfer->perform();
+}
+
+bool BulkFetcher::openDestination(Job *job, bool resume, QString *error)
+{
+    job->file.close();
+    job->partial.close();
+    job->file.setFileName(job->entry.destination);
+    job->hash.reset();
+    job->validator.clear();
+
+    if (resume) {
+        QFile validatorFile(validatorFileName(job->entry));
+        if (validatorFile.open(QIODevice::ReadOnly))
+            job->validator = validatorFile.readAll().trimmed();
+
+        // Nothing would tell appended bytes of a changed entity apart, so don't risk it
+        if (job->validator.isEmpty() && job->entry.checksum.isEmpty())
+            resume = false;
+    }
+
+    if (!resume)
+        QFile::remove(validatorFileName(job->entry));
+
+    QFileInfo info(job->file);
+    if (!QDir().mkpath(info.absolutePath())) {
+        *error = QString("cannot create directory '%1'").arg(info.absolutePath());
+        return false;
+    }
+
+    QIODevice::OpenMode mode = QIODevice::WriteOnly | (resume ? QIODevice::Append : QIODevice::Truncate);
+    if (!job->file.open(mode)) {
+        *error = QString("cannot open '%1': %2").arg(job->entry.destination, job->file.errorString());
+        return false;
+    }
+
+    job->resumeFrom = resume ? job->file.size() : 0;
+
+    if (!job->entry.checksum.isEmpty()) {
+        job->hash.reset(new QCryptographicHash(job->entry.checksumAlgorithm));
+
+        // Bytes already on disk are part of the digest too, launch() hashes them first
+        if (job->resumeFrom > 0) {
+            job->partial.setFileName(job->entry.destination);
+            if (!job->partial.open(QIODevice::ReadOnly)) {
+                *error = QString("cannot read '%1': %2").arg(job->entry.destination, job->partial.errorString());
+                job->file.close();
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void BulkFetcher::hashPartial(Job *job)
+{
+    qint64 left = job->resumeFrom - job->partial.pos();
+    job->buffer.resize(static_cast<int>(qMin(left, hashSliceSize)));
+
+    qint64 bytesRead = job->partial.read(job->buffer.data(), job->buffer.size());
+    if (bytesRead <= 0) {
+        failEntry(job->entry, QString("cannot read '%1': %2").arg(job->entry.destination, job->partial.errorString()));
+        job->partial.close();
+        job->buffer.clear();
+        job->file.close();
+        startNext(job);
+        return;
+    }
+
+    job->hash->addData(job->buffer.constData(), static_cast<int>(bytesRead));
+
+    if (bytesRead < left) {
+        // Let other transfers and reports run before the next slice
+        QTimer::singleShot(0, this, [this, job]() { hashPartial(job); });
+        return;
+    }
+
+    job->partial.close();
+    job->buffer.clear();
+    launch(job);
+}
+
+bool BulkFetcher::saveValidator(Job *job)
+{
+    // If-Range only accepts strong entity tags
+    QByteArray validator = job->responseEtag;
+    if (validator.isEmpty() || validator.startsWith("W/"))
+        validator = job->responseLastModified;
+
+    if (validator.isEmpty()) {
+        QFile::remove(validatorFileName(job->entry));
+        return true;
+    }
+
+    // Written before any body byte, so a partial file never outlives its validator
+    QSaveFile file(validatorFileName(job->entry));
+    if (!file.open(QIODevice::WriteOnly) || file.write(validator + "\n") < 0 || !file.commit()) {
+        job->error = QString("cannot write '%1': %2").arg(file.fileName(), file.errorString());
+        return false;
+    }
+    return true;
+}
+
+size_t BulkFetcher::onHeaderData(Job *job, char *data, size_t size)
+{
+    QByteArray line = QByteArray::fromRawData(data, static_cast<int>(size)).trimmed();
+    QByteArray lowerLine = line.toLower();
+
+    // Every response in a redirect chain starts with a status line
+    if (line.startsWith("HTTP/")) {
+        job->contentRangeStart = -1;
+        job->contentRangeTotal = -1;
+        job->responseEtag.clear();
+        job->responseLastModified.clear();
+    } else if (lowerLine.startsWith("etag:")) {
+        job->responseEtag = line.mid(static_cast<int>(qstrlen("etag:"))).trimmed();
+    } else if (lowerLine.startsWith("last-modified:")) {
+        job->responseLastModified = line.mid(static_cast<int>(qstrlen("last-modified:"))).trimmed();
+    } else if (lowerLine.startsWith("content-range:")) {
+        // Content-Range: bytes START-END/TOTAL or bytes */TOTAL
+        QByteArray range = line.mid(static_cast<int>(qstrlen("content-range:"))).trimmed();
+        if (range.startsWith("bytes "))
+            range = range.mid(6).trimmed();
+
+        int dash = range.indexOf('-');
+        int slash = range.indexOf('/');
+        bool ok = false;
+
+        if (dash > 0 && dash < slash) {
+            qint64 start = range.left(dash).toLongLong(&ok);
+            if (ok) job->contentRangeStart = start;
+        }
+        if (slash >= 0) {
+            qint64 total = range.mid(slash + 1).toLongLong(&ok);
+            if (ok) job->contentRangeTotal = total;
+        }
+    }
+
+    return size;
+}
+
+size_t BulkFetcher::onWriteData(Job *job, char *data, size_t size)
+{
+    if (!job->bodyChecked) {
+        job->bodyChecked = true;
+        long code = job->transfer->get<long>(CURLINFO_RESPONSE_CODE);
+
+        if (code >= 400) {
+            // Error pages must not end up in the destination file
+            job->discardBody = true;
+        } else if (code == 206 && job->contentRangeStart != job->resumeFrom) {
+            job->error = QString("server resumed at offset %1 instead of %2")
+                    .arg(job->contentRangeStart).arg(job->resumeFrom);
+            return 0;
+        } else if (code == 200 && !saveValidator(job)) {
+            return 0;
+        }
+    }
+
+    if (job->discardBody)
+        return size;
+
+    qint64 bytesWritten = job->file.write(data, static_cast<qint64>(size));
+    if (bytesWritten != static_cast<qint64>(size)) {
+        job->error = job->file.errorString();
+        return 0;
+    }
+
+    if (job->hash)
+        job->hash->addData(data, static_cast<int>(size));
+
+    bytesReceived_ += bytesWritten;
+    return size;
+}
+
+void BulkFetcher::onJobDone(Job *job, CURLcode result)
+{
+    // Last buffered write may still fail here
+    if (!job->file.flush()) {
+        failEntry(job->entry, QString("cannot write '%1': %2").arg(job->entry.destination, job->file.errorString()));
+        job->file.close();
+        startNext(job);
+        return;
+    }
+    job->file.close();
+
+    long code = job->transfer->get<long>(CURLINFO_RESPONSE_CODE);
+    bool rangeRejected = result == CURLE_RANGE_ERROR || (result == CURLE_OK && code == 416);
+
+    if (rangeRejected && job->resumeFrom > 0 && job->contentRangeTotal == job->resumeFrom) {
+        // Nothing left to fetch, the file on disk is already complete
+        completeJob(job);
+        return;
+    }
+
+    if (rangeRejected && job->resumeFrom > 0 && !job->restarted) {
+        // Partial file doesn't match what the server has now, fetch it from scratch
+        QString error;
+        job->restarted = true;
+        if (openDestination(job, false, &error)) {
+            launch(job);
+        } else {
+            failEntry(job->entry, error);
+            startNext(job);
+        }
+        return;
+    }
+
+    if (result != CURLE_OK) {
+        QString error = curl_easy_strerror(result);
+        if (!job->error.isEmpty())
+            error += ": " + job->error;
+        failEntry(job->entry, error);
+    } else if (code >= 400) {
+        failEntry(job->entry, QString("HTTP %1").arg(code));
+    } else {
+        completeJob(job);
+        return;
+    }
+
+    // Partial file is kept so the next run resumes it
+    startNext(job);
+}
+
+void BulkFetcher::completeJob(Job *job)
+{
+    QFile::remove(validatorFileName(job->entry));
+
+    if (job->hash) {
+        QByteArray digest = job->hash->result().toHex();
+        if (digest != job->entry.checksum) {
+            // Resuming a corrupt file would never succeed, so drop it
+            QFile::remove(job->entry.destination);
+            failEntry(job->entry, QString("checksum mismatch, got %1").arg(QString::fromLatin1(digest)));
+            startNext(job);
+            return;
+        }
+    }
+
+    completed_++;
+    startNext(job);
+}
+
+void BulkFetcher::failEntry(const ManifestEntry &entry, const QString &error)
+{
+    failed_++;
+    qWarning().noquote() << QString("FAILED %1 (manifest line %2): %3")
+                            .arg(entry.url.toString(), QString::number(entry.line), error);
+}
+
+void BulkFetcher::report()
+{
+    qint64 now = elapsed_.elapsed();
+    qint64 interval = now - lastReportTime_;
+    double rate = interval > 0 ? (bytesReceived_ - lastReportBytes_) * 1000.0 / interval : 0.0;
+
+    qInfo().noquote() << QString("[%1s] %2 completed, %3 failed, %4 active, %5/s, %6 received")
+                         .arg(now / 1000.0, 0, 'f', 1)
+                         .arg(completed_)
+                         .arg(failed_)
+                         .arg(activeJobs_)
+                         .arg(formatBytes(rate))
+                         .arg(formatBytes(bytesReceived_));
+
+    lastReportTime_ = now;
+    lastReportBytes_ = bytesReceived_;
+}
+
+QString BulkFetcher::formatBytes(double bytes)
+{
+    static const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 4) {
+        bytes /= 1024.0;
+        unit++;
+    }
+    return QString("%1 %2").arg(bytes, 0, 'f', unit ? 1 : 0).arg(units[unit]);
+}
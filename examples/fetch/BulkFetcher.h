@@ -0,0 +1,85 @@
+#ifndef BULKFETCHER_H
+#define BULKFETCHER_H
+
+#include <memory>
+#include <vector>
+#include <curl/curl.h>
+#include <QElapsedTimer>
+#include <QObject>
+#include "ManifestReader.h"
+
+class QTimer;
+
+// Downloads every manifest entry, keeping at most concurrency() transfers running.
+// Entries are pulled from the manifest only when a transfer slot frees up and
+// CurlEasy handles are reused between entries, so memory use does not depend
+// on the manifest size.
+//
+// Partial files are resumed with If-Range, using the validator of the response they came
+// from which is kept next to them in DESTINATION.validator until the entry completes.
+// Without a validator only entries with a checksum are resumed, the rest start over.
+class BulkFetcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BulkFetcher(QObject *parent = nullptr);
+    virtual ~BulkFetcher();
+
+    int concurrency() const { return concurrency_; }
+    void setConcurrency(int concurrency) { concurrency_ = qMax(1, concurrency); }
+
+    // Throughput is reported every reportInterval msec, 0 disables periodic reports
+    int reportInterval() const { return reportInterval_; }
+    void setReportInterval(int msec) { reportInterval_ = qMax(0, msec); }
+
+    // Set its input before start(). A manifest device must stay open until finished() is emitted.
+    ManifestReader* manifest() { return &manifest_; }
+    void start();
+
+    qint64 completedCount() const { return completed_; }
+    qint64 failedCount() const { return failed_; }
+    qint64 bytesReceived() const { return bytesReceived_; }
+
+signals:
+    void finished();
+
+protected slots:
+    void report();
+    void onManifestReadyRead();
+
+protected:
+    struct Job;
+
+    void startNext(Job *job);
+    void launch(Job *job);
+    bool openDestination(Job *job, bool resume, QString *error);
+    void hashPartial(Job *job);
+    bool saveValidator(Job *job);
+    void onJobDone(Job *job, CURLcode result);
+    void completeJob(Job *job);
+    void failEntry(const ManifestEntry &entry, const QString &error);
+    size_t onWriteData(Job *job, char *data, size_t size);
+    size_t onHeaderData(Job *job, char *data, size_t size);
+
+    static QString validatorFileName(const ManifestEntry &entry) { return entry.destination + ".validator"; }
+    static QString formatBytes(double bytes);
+
+    int             concurrency_ = 8;
+    int             reportInterval_ = 5000;
+    ManifestReader  manifest_;
+    QTimer          *reportTimer_ = nullptr;
+    QElapsedTimer   elapsed_;
+
+    std::vector<std::unique_ptr<Job>> jobs_;
+    std::vector<Job*> waitingJobs_; // Active slots waiting for more manifest input
+    int             activeJobs_ = 0;
+    bool            running_ = false;
+
+    qint64          completed_ = 0;
+    qint64          failed_ = 0;
+    qint64          bytesReceived_ = 0;
+    qint64          lastReportBytes_ = 0;
+    qint64          lastReportTime_ = 0;
+};
+
+#endif // BULKFETCHER_H
@@ -0,0 +1,190 @@
+#include "ManifestReader.h"
+#include <QIODevice>
+#include <QList>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+// Standard input is read this much at a time, and only once buffered lines are used up
+static const int stdinReadSize = 64*1024;
+
+ManifestReader::ManifestReader(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void ManifestReader::setDevice(QIODevice *device)
+{
+    delete notifier_;
+    notifier_ = nullptr;
+    device_ = device;
+    lineNumber_ = 0;
+}
+
+void ManifestReader::setStandardInput()
+{
+    setDevice(nullptr);
+    buffer_.clear();
+    bufferPos_ = 0;
+    eof_ = false;
+
+#ifdef Q_OS_UNIX
+    notifier_ = new QSocketNotifier(STDIN_FILENO, QSocketNotifier::Read, this);
+    connect(notifier_, &QSocketNotifier::activated, this, &ManifestReader::readStandardInput);
+#else
+    if (stdinFile_.open(stdin, QIODevice::ReadOnly))
+        device_ = &stdinFile_;
+#endif
+}
+
+ManifestReader::Status ManifestReader::readNext(ManifestEntry *entry, QString *error)
+{
+    Q_ASSERT(entry != nullptr);
+    Q_ASSERT(error != nullptr);
+
+    while (true) {
+        // Lines keep the trailing newline, so an empty one means end of input
+        QByteArray line;
+        if (notifier_) {
+            int newline = buffer_.indexOf('\n', bufferPos_);
+            if (newline >= 0) {
+                line = buffer_.mid(bufferPos_, newline + 1 - bufferPos_);
+                bufferPos_ = newline + 1;
+            } else if (!eof_) {
+                notifier_->setEnabled(true);
+                return Pending;
+            } else {
+                line = buffer_.mid(bufferPos_);
+                bufferPos_ = buffer_.size();
+            }
+        } else if (device_) {
+            line = device_->readLine();
+        }
+
+        if (line.isEmpty())
+            return End;
+
+        lineNumber_++;
+        line = line.trimmed();
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        *entry = ManifestEntry();
+        entry->line = lineNumber_;
+        error->clear();
+        parseLine(line, entry, error);
+        return Entry;
+    }
+}
+
+void ManifestReader::readStandardInput()
+{
+#ifdef Q_OS_UNIX
+    buffer_.remove(0, bufferPos_);
+    bufferPos_ = 0;
+
+    // Single read() after the notifier fired never blocks
+    int size = buffer_.size();
+    buffer_.resize(size + stdinReadSize);
+    ssize_t bytesRead = ::read(STDIN_FILENO, buffer_.data() + size, stdinReadSize);
+    buffer_.resize(size + static_cast<int>(qMax(bytesRead, ssize_t(0))));
+
+    if (bytesRead < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+
+    // Read errors end the manifest just like end of input
+    if (bytesRead <= 0)
+        eof_ = true;
+
+    // Buffered lines are used up first, that keeps memory bounded
+    if (eof_ || buffer_.indexOf('\n') >= 0)
+        notifier_->setEnabled(false);
+
+    emit readyRead();
+#endif
+}
+
+bool ManifestReader::parseLine(const QByteArray &line, ManifestEntry *entry, QString *error)
+{
+    QList<QByteArray> fields;
+    if (line.contains('\t')) {
+        fields = line.split('\t');
+        for (QByteArray &field : fields)
+            field = field.trimmed();
+    } else {
+        fields = line.simplified().split(' ');
+    }
+
+    if (fields.size() < 2 || fields.size() > 3 || fields[0].isEmpty() || fields[1].isEmpty()) {
+        *error = QString("line %1: expected 'URL DESTINATION [CHECKSUM]'").arg(entry->line);
+        return false;
+    }
+
+    entry->url = QUrl::fromEncoded(fields[0], QUrl::StrictMode);
+    if (!entry->url.isValid() || entry->url.isRelative()) {
+        *error = QString("line %1: invalid URL '%2'").arg(entry->line).arg(QString::fromUtf8(fields[0]));
+        return false;
+    }
+
+    entry->destination = QString::fromUtf8(fields[1]);
+
+    if (fields.size() == 3 && !parseChecksum(fields[2], entry)) {
+        *error = QString("line %1: invalid checksum '%2'").arg(entry->line).arg(QString::fromUtf8(fields[2]));
+        return false;
+    }
+
+    return true;
+}
+
+bool ManifestReader::parseChecksum(const QByteArray &text, ManifestEntry *entry)
+{
+    QByteArray digest = text.toLower();
+    QByteArray algorithm;
+
+    int colon = digest.indexOf(':');
+    if (colon >= 0) {
+        algorithm = digest.left(colon);
+        digest = digest.mid(colon + 1);
+    }
+
+    for (char c : digest) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+            return false;
+    }
+
+    if (algorithm.isEmpty()) {
+        switch (digest.size()) {
+        case 32:  algorithm = "md5"; break;
+        case 40:  algorithm = "sha1"; break;
+        case 64:  algorithm = "sha256"; break;
+        case 128: algorithm = "sha512"; break;
+        default:  return false;
+        }
+    }
+
+    int expectedSize = 0;
+    if (algorithm == "md5") {
+        entry->checksumAlgorithm = QCryptographicHash::Md5;
+        expectedSize = 32;
+    } else if (algorithm == "sha1") {
+        entry->checksumAlgorithm = QCryptographicHash::Sha1;
+        expectedSize = 40;
+    } else if (algorithm == "sha256") {
+        entry->checksumAlgorithm = QCryptographicHash::Sha256;
+        expectedSize = 64;
+    } else if (algorithm == "sha512") {
+        entry->checksumAlgorithm = QCryptographicHash::Sha512;
+        expectedSize = 128;
+    } else {
+        return false;
+    }
+
+    if (digest.size() != expectedSize)
+        return false;
+
+    entry->checksum = digest;
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef MANIFESTREADER_H
+#define MANIFESTREADER_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QObject>
+#include <QString>
+#include <QUrl>
+
+class QIODevice;
+class QSocketNotifier;
+
+struct ManifestEntry
+{
+    QUrl url;
+    QString destination;
+    QCryptographicHash::Algorithm checksumAlgorithm = QCryptographicHash::Sha256;
+    QByteArray checksum; // Lowercase hex digest, empty if the download is not verified
+    qint64 line = 0;
+};
+
+// Reads manifest entries one line at a time, so only the current line is ever held in memory.
+//
+// Each non-empty line which does not start with '#' is "URL DESTINATION [CHECKSUM]".
+// Fields are separated by tabs if the line has any, by whitespace otherwise.
+// CHECKSUM is either "algorithm:hex" (md5, sha1, sha256, sha512) or bare hex,
+// in which case the algorithm is guessed from the digest length.
+class ManifestReader : public QObject
+{
+    Q_OBJECT
+public:
+    enum Status
+    {
+        Entry,      // Either entry or error is filled
+        Pending,    // Next line isn't there yet, readyRead() is emitted when there is more input
+        End
+    };
+
+    explicit ManifestReader(QObject *parent = nullptr);
+
+    // Device is read with blocking reads, so it should be a regular file
+    void setDevice(QIODevice *device);
+    // Standard input is only read when it has data, so a slow producer doesn't stall the event loop.
+    // Where it can't be watched (Windows) it's read like a file and should be redirected from one.
+    void setStandardInput();
+
+    // Fills either entry or error (with entry->line still set) when returning Entry,
+    // depending on whether the line is valid.
+    Status readNext(ManifestEntry *entry, QString *error);
+
+signals:
+    void readyRead();
+
+protected:
+    void readStandardInput();
+    bool parseLine(const QByteArray &line, ManifestEntry *entry, QString *error);
+    static bool parseChecksum(const QByteArray &text, ManifestEntry *entry);
+
+    QIODevice       *device_ = nullptr;
+    qint64          lineNumber_ = 0;
+
+    // Standard input
+    QFile           stdinFile_;
+    QSocketNotifier *notifier_ = nullptr;
+    QByteArray      buffer_;
+    int             bufferPos_ = 0; // Start of the first line not returned yet
+    bool            eof_ = false;
+};
+
+#endif // MANIFESTREADER_H
@@ -0,0 +1,23 @@
+QT       += core
+QT       -= gui
+
+TARGET = qtcurl-fetch
+TEMPLATE = app
+
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+include (../../src/qtcurl.pri)
+
+SOURCES += main.cpp \
+        BulkFetcher.cpp \
+        ManifestReader.cpp
+
+HEADERS  += BulkFetcher.h \
+        ManifestReader.h
+
+
+# Assume libcurl is installed at place where compiler sees it by default.
+# Just like after 'apt install libcurl4-openssl-dev' on ubuntu, for example
+
+LIBS += -lcurl
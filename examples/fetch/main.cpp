@@ -0,0 +1,65 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QTimer>
+#include "BulkFetcher.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("qtcurl-fetch");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+                "Downloads every entry of a manifest, resuming partial files and verifying checksums.\n"
+                "Manifest lines are 'URL DESTINATION [CHECKSUM]', separated by tabs or whitespace.\n"
+                "CHECKSUM is 'algorithm:hex' (md5, sha1, sha256, sha512) or bare hex.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("manifest", "Manifest file, or '-' to read it from standard input.");
+
+    QCommandLineOption concurrencyOption(QStringList() << "j" << "concurrency",
+                                         "Number of simultaneous transfers.", "count", "8");
+    QCommandLineOption intervalOption(QStringList() << "i" << "interval",
+                                      "Seconds between throughput reports, 0 disables them.", "seconds", "5");
+    parser.addOption(concurrencyOption);
+    parser.addOption(intervalOption);
+    parser.process(a);
+
+    if (parser.positionalArguments().size() != 1)
+        parser.showHelp(2);
+
+    bool concurrencyOk = false, intervalOk = false;
+    int concurrency = parser.value(concurrencyOption).toInt(&concurrencyOk);
+    double interval = parser.value(intervalOption).toDouble(&intervalOk);
+    if (!concurrencyOk || concurrency < 1 || !intervalOk || interval < 0) {
+        qCritical("Invalid --concurrency or --interval value.");
+        return 2;
+    }
+
+    QFile manifest;
+    BulkFetcher fetcher;
+
+    QString manifestName = parser.positionalArguments().first();
+    if (manifestName == "-") {
+        fetcher.manifest()->setStandardInput();
+    } else {
+        manifest.setFileName(manifestName);
+        if (!manifest.open(QIODevice::ReadOnly)) {
+            qCritical("Failed to open manifest: %s", qPrintable(manifest.errorString()));
+            return 2;
+        }
+        fetcher.manifest()->setDevice(&manifest);
+    }
+
+    fetcher.setConcurrency(concurrency);
+    fetcher.setReportInterval(static_cast<int>(interval * 1000));
+
+    QObject::connect(&fetcher, &BulkFetcher::finished, &a, [&a, &fetcher]() {
+        a.exit(fetcher.failedCount() > 0 ? 1 : 0);
+    });
+
+    // Start from the event loop so that finished() of an empty manifest isn't lost
+    QTimer::singleShot(0, &fetcher, &BulkFetcher::start);
+
+    return a.exec();
+}
@@ -0,0 +1,119 @@
+#include "CurlArena.h"
+#include <new>
+#include <QThreadStorage>
+
+// Covers transfers of a busy thread being destroyed and created in bursts, the rest goes back to the heap
+static const size_t pooledArenasLimit = 16;
+
+struct CurlArenaPool
+{
+    std::vector<std::unique_ptr<CurlArena>> arenas;
+};
+
+static CurlArenaPool* threadPool()
+{
+    static QThreadStorage<std::shared_ptr<CurlArenaPool>> pools;
+    if (!pools.hasLocalData()) {
+        pools.setLocalData(std::make_shared<CurlArenaPool>());
+    }
+    return pools.localData().get();
+}
+
+CurlArena::CurlArena(size_t blockSize, size_t retainLimit)
+    : blockSize_(blockSize)
+    , retainLimit_(retainLimit)
+{
+}
+
+CurlArena::~CurlArena()
+{
+    for (const Block &block : blocks_)
+        ::operator delete(block.data);
+}
+
+void* CurlArena::allocate(size_t size, size_t alignment)
+{
+    Q_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0 && alignment <= alignof(std::max_align_t));
+    counters_.allocations++;
+
+    // Blocks left from before the last reset are reused in order
+    while (current_ < blocks_.size()) {
+        const Block &block = blocks_[current_];
+        size_t aligned = (offset_ + alignment - 1) & ~(alignment - 1);
+        if (aligned + size <= block.size) {
+            offset_ = aligned + size;
+            bytesUsed_ += size;
+            return block.data + aligned;
+        }
+        current_++;
+        offset_ = 0;
+    }
+
+    // Heap blocks are aligned for any type, so oversized requests fit at offset 0
+    Block block;
+    block.size = qMax(blockSize_, size);
+    block.data = static_cast<char*>(::operator new(block.size));
+    counters_.blockAllocations++;
+
+    blocks_.push_back(block);
+    current_ = blocks_.size() - 1;
+    offset_ = size;
+    bytesUsed_ += size;
+    return block.data;
+}
+
+void CurlArena::reset()
+{
+    // Don't let a single huge response pin its memory forever
+    size_t retained = 0;
+    size_t kept = 0;
+    for (const Block &block : blocks_) {
+        if (retained + block.size <= retainLimit_) {
+            retained += block.size;
+            blocks_[kept++] = block;
+        } else {
+            ::operator delete(block.data);
+        }
+    }
+    blocks_.resize(kept);
+
+    current_ = 0;
+    offset_ = 0;
+    bytesUsed_ = 0;
+    counters_ = Counters();
+}
+
+size_t CurlArena::capacity() const
+{
+    size_t result = 0;
+    for (const Block &block : blocks_)
+        result += block.size;
+    return result;
+}
+
+std::unique_ptr<CurlArena> CurlArena::acquire()
+{
+    CurlArenaPool *pool = threadPool();
+    if (pool->arenas.empty())
+        return std::unique_ptr<CurlArena>(new CurlArena);
+
+    std::unique_ptr<CurlArena> arena = std::move(pool->arenas.back());
+    pool->arenas.pop_back();
+    return arena;
+}
+
+void CurlArena::recycle(std::unique_ptr<CurlArena> arena)
+{
+    if (!arena)
+        return;
+
+    CurlArenaPool *pool = threadPool();
+    if (pool->arenas.size() >= pooledArenasLimit)
+        return;
+
+    arena->reset();
+    pool->arenas.push_back(std::move(arena));
+}
+
+size_t CurlArena::maxPooledArenas()
+    { return pooledArenasLimit; }
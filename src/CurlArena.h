@@ -0,0 +1,61 @@
+#ifndef CURLARENA_H
+#define CURLARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <QtGlobal>
+
+// Bump allocator for per-transfer data: everything allocated from it is released
+// at once by reset(). Blocks are kept across resets up to retainLimit bytes,
+// and arenas are recycled per thread by acquire() and recycle(), so a steady
+// stream of transfers doesn't hit the heap at all.
+//
+// Idle memory is bounded by maxPooledArenas() * retainLimit per thread,
+// 4 MiB with the defaults.
+//
+// Not thread-safe, like the CurlEasy owning it.
+class CurlArena
+{
+public:
+    // Counted since the last reset(), i.e. per request for an arena owned by CurlEasy
+    struct Counters
+    {
+        quint64 allocations = 0;        // Served from arena blocks
+        quint64 blockAllocations = 0;   // Went to the heap
+    };
+
+    explicit CurlArena(size_t blockSize = 64*1024, size_t retainLimit = 256*1024);
+    ~CurlArena();
+
+    CurlArena(const CurlArena &) = delete;
+    CurlArena& operator=(const CurlArena &) = delete;
+
+    void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    void reset();
+
+    size_t bytesUsed() const { return bytesUsed_; }
+    size_t capacity() const;
+    Counters counters() const { return counters_; }
+
+    static std::unique_ptr<CurlArena> acquire();
+    static void recycle(std::unique_ptr<CurlArena> arena);
+    static size_t maxPooledArenas();
+
+protected:
+    struct Block
+    {
+        char    *data;
+        size_t  size;
+    };
+
+    std::vector<Block>  blocks_;
+    size_t              blockSize_;
+    size_t              retainLimit_;
+    size_t              current_ = 0;
+    size_t              offset_ = 0;
+    size_t              bytesUsed_ = 0;
+    Counters            counters_;
+};
+
+#endif // CURLARENA_H
@@ -1,5 +1,11 @@
+// This disables min & max macros declaration in windows.h which will be included somewhere there
+#define NOMINMAX
+
 #include "CurlEasy.h"
+#include <cstring>
+#include <limits>
 #include "CurlMulti.h"
+#include "CurlUploadSource.h"
 
 CurlEasy::CurlEasy(QObject *parent)
     : QObject(parent)
@@ -25,6 +31,8 @@ CurlEasy::~CurlEasy()
         curl_slist_free_all(curlHttpHeaders_);
         curlHttpHeaders_ = nullptr;
     }
+
+    CurlArena::recycle(std::move(arena_));
 }
 
 void CurlEasy::deleteLater()
@@ -38,8 +46,22 @@ void CurlEasy::perform()
     if (isRunning())
         return;
 
+    if (arena_) {
+        arena_->reset();
+        responseBodyHead_ = nullptr;
+        responseBodyTail_ = nullptr;
+        responseBodySize_ = 0;
+    }
+
     rebuildCurlHttpHeaders();
 
+    // Reused handle starts the body from the beginning again, and the source
+    // may have grown since it was installed
+    if (uploadSource_) {
+        uploadSource_->seek(0);
+        setUploadSize(uploadSource_->size());
+    }
+
     if (preferredMulti_)
         runningOnMulti_ = preferredMulti_;
     else
@@ -85,6 +107,11 @@ void CurlEasy::rebuildCurlHttpHeaders()
         curlHttpHeaders_ = nullptr;
     }
 
+    if (arena_) {
+        buildArenaHttpHeaders();
+        return;
+    }
+
     for (auto it = httpHeaders_.begin(); it != httpHeaders_.end(); ++it) {
         const QString &header = it.key();
         const QByteArray &value = it.value();
@@ -100,8 +127,113 @@ void CurlEasy::rebuildCurlHttpHeaders()
     set(CURLOPT_HTTPHEADER, curlHttpHeaders_);
 }
 
+void CurlEasy::buildArenaHttpHeaders()
+{
+    // Same list as curl_slist_append would build, but nodes and strings live in
+    // the arena. libcurl only reads the list, so it never tries to free them.
+    struct curl_slist *list = nullptr;
+    struct curl_slist **tail = &list;
+
+    for (auto it = httpHeaders_.begin(); it != httpHeaders_.end(); ++it) {
+        const QString &header = it.key();
+        const QByteArray &value = it.value();
+
+        // Header names are ASCII tokens in practice, copy them without a UTF-8 temporary
+        bool ascii = true;
+        for (QChar c : header) {
+            if (c.unicode() >= 0x80) {
+                ascii = false;
+                break;
+            }
+        }
+        QByteArray utf8Header = ascii ? QByteArray() : header.toUtf8();
+        size_t headerSize = ascii ? static_cast<size_t>(header.size()) : static_cast<size_t>(utf8Header.size());
+
+        char *line = static_cast<char*>(arena_->allocate(headerSize + 2 + static_cast<size_t>(value.size()) + 1, 1));
+        char *p = line;
+        if (ascii) {
+            for (QChar c : header)
+                *p++ = static_cast<char>(c.unicode());
+        } else {
+            std::memcpy(p, utf8Header.constData(), headerSize);
+            p += headerSize;
+        }
+        *p++ = ':';
+        *p++ = ' ';
+        std::memcpy(p, value.constData(), static_cast<size_t>(value.size()));
+        p += value.size();
+        *p = char(0);
+
+        struct curl_slist *node = static_cast<struct curl_slist*>(
+                    arena_->allocate(sizeof(struct curl_slist), alignof(struct curl_slist)));
+        node->data = line;
+        node->next = nullptr;
+        *tail = node;
+        tail = &node->next;
+    }
+
+    set(CURLOPT_HTTPHEADER, list);
+}
+
+void CurlEasy::setArenaEnabled(bool enabled)
+{
+    if (isRunning() || enabled == arenaEnabled_)
+        return;
+
+    arenaEnabled_ = enabled;
+
+    if (arenaEnabled_) {
+        arena_ = CurlArena::acquire();
+        // Header list has to be rebuilt in the arena on perform()
+        if (curlHttpHeaders_) {
+            curl_slist_free_all(curlHttpHeaders_);
+            curlHttpHeaders_ = nullptr;
+            set(CURLOPT_HTTPHEADER, static_cast<struct curl_slist*>(nullptr));
+        }
+        set(CURLOPT_WRITEFUNCTION, staticCurlWriteFunction);
+        set(CURLOPT_WRITEDATA, this);
+    } else {
+        if (httpHeadersWereSet_)
+            set(CURLOPT_HTTPHEADER, static_cast<struct curl_slist*>(nullptr));
+        responseBodyHead_ = nullptr;
+        responseBodyTail_ = nullptr;
+        responseBodySize_ = 0;
+        CurlArena::recycle(std::move(arena_));
+        setWriteFunction(writeFunction_);
+    }
+}
+
+QByteArray CurlEasy::responseBody() const
+{
+    QByteArray body;
+    if (responseBodySize_ > std::numeric_limits<int>::max())
+        return body;
+
+    body.reserve(static_cast<int>(responseBodySize_));
+    forEachResponseChunk([&body](const char *data, size_t size) {
+        body.append(data, static_cast<int>(size));
+    });
+    return body;
+}
+
+void CurlEasy::appendResponseBody(const char *data, size_t size)
+{
+    BodyChunk *chunk = static_cast<BodyChunk*>(arena_->allocate(sizeof(BodyChunk) + size, alignof(BodyChunk)));
+    chunk->next = nullptr;
+    chunk->size = size;
+    std::memcpy(chunk->data(), data, size);
+
+    if (responseBodyTail_)
+        responseBodyTail_->next = chunk;
+    else
+        responseBodyHead_ = chunk;
+    responseBodyTail_ = chunk;
+    responseBodySize_ += static_cast<qint64>(size);
+}
+
 void CurlEasy::setReadFunction(const CurlEasy::DataFunction &function)
 {
+    removeUploadSource();
     readFunction_ = function;
     if (readFunction_) {
         set(CURLOPT_READFUNCTION, staticCurlReadFunction);
@@ -115,7 +247,7 @@ void CurlEasy::setReadFunction(const CurlEasy::DataFunction &function)
 void CurlEasy::setWriteFunction(const CurlEasy::DataFunction &function)
 {
     writeFunction_ = function;
-    if (writeFunction_) {
+    if (writeFunction_ || arenaEnabled_) {
         set(CURLOPT_WRITEFUNCTION, staticCurlWriteFunction);
         set(CURLOPT_WRITEDATA, this);
     } else {
@@ -138,6 +270,7 @@ void CurlEasy::setHeaderFunction(const CurlEasy::DataFunction &function)
 
 void CurlEasy::setSeekFunction(const CurlEasy::SeekFunction &function)
 {
+    removeUploadSource();
     seekFunction_ = function;
     if (seekFunction_) {
         set(CURLOPT_SEEKFUNCTION, staticCurlSeekFunction);
@@ -148,6 +281,36 @@ void CurlEasy::setSeekFunction(const CurlEasy::SeekFunction &function)
     }
 }
 
+void CurlEasy::setUploadSource(const std::shared_ptr<CurlUploadSource> &source)
+{
+    setReadFunction(nullptr);
+    setSeekFunction(nullptr);
+    uploadSource_ = source;
+
+    if (uploadSource_) {
+        set(CURLOPT_READFUNCTION, staticCurlReadFunction);
+        set(CURLOPT_READDATA, this);
+        set(CURLOPT_SEEKFUNCTION, staticCurlSeekFunction);
+        set(CURLOPT_SEEKDATA, this);
+        setUploadSize(uploadSource_->size());
+    }
+}
+
+void CurlEasy::removeUploadSource()
+{
+    // Sizes set by the user without a source are left alone
+    if (uploadSource_) {
+        uploadSource_.reset();
+        setUploadSize(-1);
+    }
+}
+
+void CurlEasy::setUploadSize(qint64 size)
+{
+    set(CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(size));
+    set(CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(size));
+}
+
 size_t CurlEasy::staticCurlWriteFunction(char *data, size_t size, size_t nitems, void *easyPtr)
 {
     CurlEasy *easy = static_cast<CurlEasy*>(easyPtr);
@@ -155,8 +318,11 @@ size_t CurlEasy::staticCurlWriteFunction(char *data, size_t size, size_t nitems,
 
     if (easy->writeFunction_)
         return easy->writeFunction_(data, size*nitems);
-    else
-        return  size*nitems;
+
+    if (easy->arena_)
+        easy->appendResponseBody(data, size*nitems);
+
+    return  size*nitems;
 }
 
 size_t CurlEasy::staticCurlHeaderFunction(char *data, size_t size, size_t nitems, void *easyPtr)
@@ -175,6 +341,21 @@ int CurlEasy::staticCurlSeekFunction(void *easyPtr, curl_off_t offset, int origi
     CurlEasy *easy = static_cast<CurlEasy*>(easyPtr);
     Q_ASSERT(easy != nullptr);
 
+    if (easy->uploadSource_) {
+        if (!easy->uploadSource_->isSeekable())
+            return CURL_SEEKFUNC_CANTSEEK;
+
+        qint64 position = static_cast<qint64>(offset);
+        if (origin == SEEK_CUR)
+            position += easy->uploadSource_->pos();
+        else if (origin == SEEK_END && easy->uploadSource_->size() >= 0)
+            position += easy->uploadSource_->size();
+        else if (origin != SEEK_SET)
+            return CURL_SEEKFUNC_CANTSEEK;
+
+        return easy->uploadSource_->seek(position) ? CURL_SEEKFUNC_OK : CURL_SEEKFUNC_FAIL;
+    }
+
     if (easy->seekFunction_)
         return easy->seekFunction_(static_cast<qint64>(offset), origin);
     else
@@ -186,7 +367,9 @@ size_t CurlEasy::staticCurlReadFunction(char *buffer, size_t size, size_t nitems
     CurlEasy *transfer = static_cast<CurlEasy*>(easyPtr);
     Q_ASSERT(transfer != nullptr);
 
-    if (transfer->readFunction_)
+    if (transfer->uploadSource_)
+        return transfer->uploadSource_->read(buffer, size*nitems);
+    else if (transfer->readFunction_)
         return transfer->readFunction_(buffer, size*nitems);
     else
         return size*nitems;
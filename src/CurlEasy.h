@@ -2,12 +2,15 @@
 #define CURLEASY_H
 
 #include <functional>
+#include <memory>
 #include <curl/curl.h>
 #include <QMap>
 #include <QObject>
 #include <QUrl>
+#include "CurlArena.h"
 
 class CurlMulti;
+class CurlUploadSource;
 
 class CurlEasy : public QObject
 {
@@ -33,6 +36,12 @@ public:
     void setHeaderFunction(const DataFunction &function);
     void setSeekFunction(const SeekFunction &function);
 
+    // Replaces read & seek functions. Source is rewound and CURLOPT_INFILESIZE_LARGE and
+    // CURLOPT_POSTFIELDSIZE_LARGE are set from its size on every perform(). Set nullptr to remove it,
+    // which resets both sizes to unknown. So does setting a read or seek function.
+    void setUploadSource(const std::shared_ptr<CurlUploadSource> &source);
+    std::shared_ptr<CurlUploadSource> uploadSource() const { return uploadSource_; }
+
     // For the list of available get options and valid parameter types consult curl_easy_getinfo manual
     template<typename T> bool get(CURLINFO info, T *pointer) { return curl_easy_getinfo(handle_, info, pointer) == CURLE_OK; }
     template<typename T> T get(CURLINFO info);
@@ -46,6 +55,21 @@ public:
     QByteArray httpHeaderRaw(const QString &header) const;
     void setHttpHeaderRaw(const QString &header, const QByteArray &encodedValue);
 
+    // Opt-in per-transfer arena for HTTP header list and response body. It is reset on every
+    // perform() and recycled through the thread pool on destruction.
+    // Without a write function the response body is kept in the arena until the next perform().
+    // Can't be changed while the transfer is running.
+    void setArenaEnabled(bool enabled);
+    bool isArenaEnabled() const { return arenaEnabled_; }
+    // Arena allocations of the last perform(), blockAllocations is what still went to the heap
+    CurlArena::Counters arenaCounters() const { return arena_ ? arena_->counters() : CurlArena::Counters(); }
+    qint64 responseBodySize() const { return responseBodySize_; }
+    // Calls visitor(const char *data, size_t size) for each body chunk in order, without copying
+    template<typename F> void forEachResponseChunk(F visitor) const;
+    // Copies the body into one QByteArray. Empty if the body doesn't fit into it (2 GiB),
+    // use forEachResponseChunk for such ones.
+    QByteArray responseBody() const;
+
     CURL* handle() { return handle_; }
     void setPreferredMulti(CurlMulti *multi) { preferredMulti_ = multi; }
 
@@ -62,6 +86,10 @@ protected:
     void removeFromMulti();
     void onCurlMessage(CURLMsg *message);
     void rebuildCurlHttpHeaders();
+    void setUploadSize(qint64 size);
+    void removeUploadSource();
+    void buildArenaHttpHeaders();
+    void appendResponseBody(const char *data, size_t size);
 
     static size_t staticCurlReadFunction(char *data, size_t size, size_t nitems, void *easyPtr);
     static size_t staticCurlWriteFunction(char *data, size_t size, size_t nitems, void *easyPtr);
@@ -78,14 +106,36 @@ protected:
     DataFunction    writeFunction_;
     DataFunction    headerFunction_;
     SeekFunction    seekFunction_;
+    std::shared_ptr<CurlUploadSource> uploadSource_;
 
     bool                        httpHeadersWereSet_ = false;
     QMap<QString, QByteArray>   httpHeaders_;
     struct curl_slist*          curlHttpHeaders_ = nullptr;
 
+    struct BodyChunk
+    {
+        BodyChunk   *next;
+        size_t      size;
+        // Data follows the header in the same arena allocation
+        char* data() { return reinterpret_cast<char*>(this + 1); }
+        const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    };
+
+    bool                        arenaEnabled_ = false;
+    std::unique_ptr<CurlArena>  arena_;
+    BodyChunk                   *responseBodyHead_ = nullptr;
+    BodyChunk                   *responseBodyTail_ = nullptr;
+    qint64                      responseBodySize_ = 0;
+
     friend class CurlMulti;
 };
 
+template<typename F> void CurlEasy::forEachResponseChunk(F visitor) const
+{
+    for (const BodyChunk *chunk = responseBodyHead_; chunk != nullptr; chunk = chunk->next)
+        visitor(chunk->data(), chunk->size);
+}
+
 template<typename T> T CurlEasy::get(CURLINFO info)
 {
     T parameter;
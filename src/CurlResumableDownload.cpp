@@ -0,0 +1,577 @@
+#include "CurlResumableDownload.h"
+#include <QSaveFile>
+#include <QTimer>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const QByteArray journalSignature = "qtcurl-journal 1";
+static const QCryptographicHash::Algorithm chunkHashAlgorithm = QCryptographicHash::Sha256;
+static const int chunkRecordSize = 64 + 1; // Hex SHA-256 and a newline
+// Bytes on disk are verified this much per event loop iteration, so other transfers keep running
+static const qint64 verifySliceSize = 4*1024*1024;
+
+// Journal must never claim bytes which are still in OS caches only
+static bool syncFile(QFile &file)
+{
+    if (!file.flush())
+        return false;
+#ifdef _WIN32
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+CurlResumableDownload::CurlResumableDownload(QObject *parent)
+    : QObject(parent)
+    , transfer_(new CurlEasy(this))
+    , verifyTimer_(new QTimer(this))
+    , chunkHash_(chunkHashAlgorithm)
+{
+    verifyTimer_->setSingleShot(true);
+    connect(verifyTimer_, &QTimer::timeout, this, &CurlResumableDownload::verifyChunks);
+
+    transfer_->setWriteFunction([this](char *data, size_t size)->size_t {
+        return onWriteData(data, size);
+    });
+    transfer_->setHeaderFunction([this](char *data, size_t size)->size_t {
+        return onHeaderData(data, size);
+    });
+
+    connect(transfer_, &CurlEasy::done, this, &CurlResumableDownload::onTransferDone);
+    connect(transfer_, &CurlEasy::aborted, this, &CurlResumableDownload::onTransferAborted);
+    connect(transfer_, &CurlEasy::progress, this, [this]() {
+        emit progress(written_, totalSize_);
+    });
+}
+
+CurlResumableDownload::~CurlResumableDownload()
+{
+    // Keep whatever has been received for the next run
+    commit();
+    delete transfer_;
+}
+
+void CurlResumableDownload::perform()
+{
+    if (isRunning())
+        return;
+
+    lastResult_ = CURLE_OK;
+    errorString_.clear();
+    restarted_ = false;
+
+    if (!openFile(true)) {
+        finish(CURLE_WRITE_ERROR, errorString_);
+        return;
+    }
+
+    // Anything past the committed length may be garbage left by a crash
+    qint64 length = qMin(committed_, file_.size());
+
+    if (chunkSize_ > 0 && length >= chunkSize_ && !chunkHashes_.isEmpty()) {
+        // Hashing what is on disk takes a while for big files, do it in slices
+        verifyLength_ = qMin(length / chunkSize_, static_cast<qint64>(chunkHashes_.size())) * chunkSize_;
+        verifiedLength_ = 0;
+        chunkHash_.reset();
+        if (!file_.seek(0)) {
+            errorString_ = QString("Cannot read '%1': %2").arg(fileName_, file_.errorString());
+            file_.close();
+            finish(CURLE_READ_ERROR, errorString_);
+            return;
+        }
+        verifying_ = true;
+        verifyTimer_->start(0);
+        return;
+    }
+
+    resumeAt(chunkSize_ > 0 ? 0 : length);
+}
+
+void CurlResumableDownload::abort()
+{
+    if (verifying_) {
+        verifying_ = false;
+        verifyTimer_->stop();
+        file_.close();
+        emit aborted();
+        return;
+    }
+
+    transfer_->abort();
+}
+
+bool CurlResumableDownload::openFile(bool resume)
+{
+    file_.close();
+    file_.setFileName(fileName_);
+
+    bool haveJournal = resume && loadJournal();
+    if (!haveJournal)
+        resetJournal();
+
+    if (!file_.open(QIODevice::ReadWrite)) {
+        errorString_ = QString("Cannot open '%1': %2").arg(fileName_, file_.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+void CurlResumableDownload::resumeAt(qint64 length)
+{
+    if (chunkSize_ > 0)
+        chunkHashes_ = chunkHashes_.mid(0, static_cast<int>(length / chunkSize_));
+
+    // File is closed first so that finish() doesn't commit a length which isn't there
+    if (!file_.resize(length) || !file_.seek(length)) {
+        errorString_ = QString("Cannot truncate '%1': %2").arg(fileName_, file_.errorString());
+        file_.close();
+        finish(CURLE_WRITE_ERROR, errorString_);
+        return;
+    }
+
+    committed_ = length;
+    written_ = length;
+    resumeFrom_ = length;
+    chunkHash_.reset();
+
+    if (!saveJournal()) {
+        file_.close();
+        finish(CURLE_WRITE_ERROR, errorString_);
+        return;
+    }
+
+    startTransfer();
+}
+
+void CurlResumableDownload::startTransfer()
+{
+    bodyChecked_ = false;
+    discardBody_ = false;
+    restartPending_ = false;
+    responseEtag_.clear();
+    responseLastModified_.clear();
+    responseRangeStart_ = -1;
+    responseRangeTotal_ = -1;
+
+    transfer_->set(CURLOPT_URL, url_);
+    transfer_->set(CURLOPT_RESUME_FROM_LARGE, static_cast<curl_off_t>(resumeFrom_));
+
+    // Server answers If-Range with the whole entity if it doesn't match anymore
+    QByteArray validator = ifRangeValidator();
+    if (resumeFrom_ > 0 && !validator.isEmpty())
+        transfer_->setHttpHeaderRaw("If-Range", validator);
+    else if (transfer_->hasHttpHeader("If-Range"))
+        transfer_->removeHttpHeader("If-Range");
+
+    transfer_->perform();
+}
+
+void CurlResumableDownload::restart()
+{
+    restarted_ = true;
+    emit restarted();
+
+    if (!openFile(false)) {
+        finish(CURLE_WRITE_ERROR, errorString_);
+        return;
+    }
+
+    resumeAt(0);
+}
+
+void CurlResumableDownload::finish(CURLcode result, const QString &errorString)
+{
+    // Journal goes away only when the whole file is really on disk
+    QString error = errorString;
+    if (result == CURLE_OK && !syncFile(file_)) {
+        result = CURLE_WRITE_ERROR;
+        error = QString("Cannot write '%1': %2").arg(fileName_, file_.errorString());
+    }
+
+    lastResult_ = result;
+
+    if (result == CURLE_OK) {
+        file_.close();
+        QFile::remove(journalFileName());
+        QFile::remove(chunksFileName());
+        committed_ = written_;
+    } else {
+        errorString_ = error.isEmpty() ? QString(curl_easy_strerror(result)) : error;
+        commit();
+        file_.close();
+    }
+
+    emit done(result);
+}
+
+bool CurlResumableDownload::commit()
+{
+    // Journal is still describing what is being verified
+    if (!file_.isOpen() || verifying_)
+        return true;
+
+    // With chunk hashes only whole chunks can be verified on resume
+    qint64 length = chunkSize_ > 0 ? chunkHashes_.size() * chunkSize_ : written_;
+    if (length == committed_)
+        return true;
+
+    if (!syncFile(file_)) {
+        errorString_ = QString("Cannot sync '%1': %2").arg(fileName_, file_.errorString());
+        return false;
+    }
+
+    committed_ = length;
+    return saveJournal();
+}
+
+void CurlResumableDownload::resetJournal()
+{
+    etag_.clear();
+    lastModified_.clear();
+    totalSize_ = -1;
+    committed_ = 0;
+    chunkHashes_.clear();
+    chunksSaved_ = 0;
+}
+
+bool CurlResumableDownload::loadJournal()
+{
+    QFile journal(journalFileName());
+    if (!journal.open(QIODevice::ReadOnly))
+        return false;
+
+    if (journal.readLine().trimmed() != journalSignature)
+        return false;
+
+    QUrl url;
+    QByteArray etag, lastModified;
+    qint64 totalSize = -1, committed = -1, chunkSize = 0, chunks = 0;
+
+    while (!journal.atEnd()) {
+        QByteArray line = journal.readLine().trimmed();
+        int space = line.indexOf(' ');
+        QByteArray key = space < 0 ? line : line.left(space);
+        QByteArray value = space < 0 ? QByteArray() : line.mid(space + 1);
+
+        if (key == "url")
+            url = QUrl::fromEncoded(value);
+        else if (key == "etag")
+            etag = value;
+        else if (key == "last-modified")
+            lastModified = value;
+        else if (key == "total")
+            totalSize = value.toLongLong();
+        else if (key == "committed")
+            committed = value.toLongLong();
+        else if (key == "chunk-size")
+            chunkSize = value.toLongLong();
+        else if (key == "chunks")
+            chunks = value.toLongLong();
+    }
+
+    // Journal written for another URL or chunk layout can't be trusted
+    if (url != url_ || chunkSize != chunkSize_ || committed < 0)
+        return false;
+
+    // Hashes past the recorded count may be left from a crash in the middle of a commit
+    QList<QByteArray> chunkHashes;
+    if (chunks > 0) {
+        QFile chunksFile(chunksFileName());
+        if (!chunksFile.open(QIODevice::ReadOnly))
+            return false;
+        while (chunkHashes.size() < chunks) {
+            QByteArray record = chunksFile.read(chunkRecordSize);
+            if (record.size() != chunkRecordSize)
+                break;
+            chunkHashes << record.trimmed();
+        }
+    }
+
+    etag_ = etag;
+    lastModified_ = lastModified;
+    totalSize_ = totalSize;
+    committed_ = committed;
+    chunkHashes_ = chunkHashes;
+    chunksSaved_ = chunkHashes.size();
+    return true;
+}
+
+bool CurlResumableDownload::saveChunkHashes()
+{
+    // Only new hashes are appended, so journal I/O stays proportional to the data received
+    QFile chunksFile(chunksFileName());
+    chunksSaved_ = qMin(chunksSaved_, chunkHashes_.size());
+
+    if (!chunksFile.open(QIODevice::ReadWrite)
+            || !chunksFile.resize(static_cast<qint64>(chunksSaved_) * chunkRecordSize)
+            || !chunksFile.seek(chunksFile.size())) {
+        errorString_ = QString("Cannot write journal '%1': %2").arg(chunksFile.fileName(), chunksFile.errorString());
+        return false;
+    }
+
+    QByteArray data;
+    for (int i = chunksSaved_; i < chunkHashes_.size(); ++i)
+        data += chunkHashes_[i] + "\n";
+
+    if (chunksFile.write(data) != data.size() || !syncFile(chunksFile)) {
+        errorString_ = QString("Cannot write journal '%1': %2").arg(chunksFile.fileName(), chunksFile.errorString());
+        return false;
+    }
+
+    chunksSaved_ = chunkHashes_.size();
+    return true;
+}
+
+bool CurlResumableDownload::saveJournal()
+{
+    // Hashes must be on disk before the header counting them
+    if (chunkSize_ > 0 && !saveChunkHashes())
+        return false;
+
+    // QSaveFile replaces the journal atomically, so a crash leaves either the old or the new one
+    QSaveFile journal(journalFileName());
+    if (!journal.open(QIODevice::WriteOnly)) {
+        errorString_ = QString("Cannot write journal '%1': %2").arg(journal.fileName(), journal.errorString());
+        return false;
+    }
+
+    QByteArray data;
+    data += journalSignature + "\n";
+    data += "url " + url_.toEncoded() + "\n";
+    data += "etag " + etag_ + "\n";
+    data += "last-modified " + lastModified_ + "\n";
+    data += "total " + QByteArray::number(totalSize_) + "\n";
+    data += "committed " + QByteArray::number(committed_) + "\n";
+    data += "chunk-size " + QByteArray::number(chunkSize_) + "\n";
+    data += "chunks " + QByteArray::number(chunksSaved_) + "\n";
+
+    journal.write(data);
+    if (!journal.commit()) {
+        errorString_ = QString("Cannot write journal '%1': %2").arg(journal.fileName(), journal.errorString());
+        return false;
+    }
+
+    return true;
+}
+
+void CurlResumableDownload::verifyChunks()
+{
+    Q_ASSERT(chunkSize_ > 0);
+
+    // Slice never crosses a chunk boundary, so chunkHash_ always covers one chunk
+    qint64 chunkLeft = verifiedLength_ + chunkSize_ - file_.pos();
+    verifyBuffer_.resize(static_cast<int>(qMin(chunkLeft, verifySliceSize)));
+
+    qint64 bytesRead = file_.read(verifyBuffer_.data(), verifyBuffer_.size());
+    if (bytesRead <= 0) {
+        // Unreadable data is fetched again
+        verifying_ = false;
+        verifyBuffer_.clear();
+        resumeAt(verifiedLength_);
+        return;
+    }
+
+    chunkHash_.addData(verifyBuffer_.constData(), static_cast<int>(bytesRead));
+
+    if (bytesRead == chunkLeft) {
+        int chunk = static_cast<int>(verifiedLength_ / chunkSize_);
+        bool matches = chunkHash_.result().toHex() == chunkHashes_[chunk];
+        chunkHash_.reset();
+
+        if (matches)
+            verifiedLength_ += chunkSize_;
+
+        if (!matches || verifiedLength_ >= verifyLength_) {
+            verifying_ = false;
+            verifyBuffer_.clear();
+            resumeAt(verifiedLength_);
+            return;
+        }
+    }
+
+    verifyTimer_->start(0);
+}
+
+void CurlResumableDownload::hashChunks(const char *data, qint64 size)
+{
+    if (chunkSize_ <= 0)
+        return;
+
+    qint64 position = written_;
+    while (size > 0) {
+        qint64 part = qMin(size, chunkSize_ - position % chunkSize_);
+        chunkHash_.addData(data, static_cast<int>(part));
+        data += part;
+        size -= part;
+        position += part;
+
+        if (position % chunkSize_ == 0) {
+            chunkHashes_ << chunkHash_.result().toHex();
+            chunkHash_.reset();
+        }
+    }
+}
+
+bool CurlResumableDownload::responseMatchesJournal() const
+{
+    if (responseRangeStart_ != resumeFrom_)
+        return false;
+    if (totalSize_ >= 0 && responseRangeTotal_ >= 0 && responseRangeTotal_ != totalSize_)
+        return false;
+    if (!etag_.isEmpty() && !responseEtag_.isEmpty() && responseEtag_ != etag_)
+        return false;
+    if (!lastModified_.isEmpty() && !responseLastModified_.isEmpty() && responseLastModified_ != lastModified_)
+        return false;
+    return true;
+}
+
+bool CurlResumableDownload::isHttp() const
+{
+    QString scheme = url_.scheme().toLower();
+    return scheme == "http" || scheme == "https";
+}
+
+QByteArray CurlResumableDownload::ifRangeValidator() const
+{
+    // If-Range only accepts strong entity tags
+    if (!etag_.isEmpty() && !etag_.startsWith("W/"))
+        return etag_;
+    return lastModified_;
+}
+
+void CurlResumableDownload::onTransferDone(CURLcode result)
+{
+    long code = transfer_->get<long>(CURLINFO_RESPONSE_CODE);
+    bool rangeNotSatisfiable = result == CURLE_OK && code == 416 && resumeFrom_ > 0;
+
+    if (rangeNotSatisfiable && responseRangeTotal_ == resumeFrom_
+            && (totalSize_ < 0 || totalSize_ == resumeFrom_)) {
+        // Everything has been received already
+        finish(CURLE_OK);
+        return;
+    }
+
+    // libcurl doesn't call the write function at all for a 200 whose length equals
+    // the resume offset, so a changed entity of that size only shows up here
+    bool entityReplaced = result == CURLE_OK && code == 200 && resumeFrom_ > 0;
+
+    if (restartPending_ || result == CURLE_RANGE_ERROR || rangeNotSatisfiable || entityReplaced) {
+        // Entity on the server isn't the one we have the beginning of
+        if (!restarted_)
+            restart();
+        else
+            finish(CURLE_RANGE_ERROR, "Server entity keeps changing");
+        return;
+    }
+
+    if (result != CURLE_OK)
+        finish(result, errorString_);
+    else if (isHttp() && code != 200 && code != 206)
+        finish(CURLE_HTTP_RETURNED_ERROR, QString("Unexpected HTTP response %1").arg(code));
+    else if (totalSize_ >= 0 && written_ != totalSize_)
+        finish(CURLE_PARTIAL_FILE, QString("Received %1 of %2 bytes").arg(written_).arg(totalSize_));
+    else
+        finish(CURLE_OK);
+}
+
+void CurlResumableDownload::onTransferAborted()
+{
+    commit();
+    file_.close();
+    emit aborted();
+}
+
+size_t CurlResumableDownload::onWriteData(char *data, size_t size)
+{
+    if (!bodyChecked_) {
+        bodyChecked_ = true;
+        long code = transfer_->get<long>(CURLINFO_RESPONSE_CODE);
+
+        if (isHttp() && code != 200 && code != 206) {
+            // Error pages and redirect bodies must not end up in the file
+            discardBody_ = true;
+        } else if (code == 206) {
+            if (!responseMatchesJournal()) {
+                restartPending_ = true;
+                return 0;
+            }
+            if (totalSize_ < 0)
+                totalSize_ = responseRangeTotal_;
+        } else {
+            if (resumeFrom_ == 0) {
+                etag_ = responseEtag_;
+                lastModified_ = responseLastModified_;
+            }
+
+            curl_off_t length = -1;
+            transfer_->get(CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+            totalSize_ = length >= 0 ? resumeFrom_ + static_cast<qint64>(length) : -1;
+        }
+    }
+
+    if (discardBody_)
+        return size;
+
+    qint64 bytesWritten = file_.write(data, static_cast<qint64>(size));
+    if (bytesWritten != static_cast<qint64>(size)) {
+        errorString_ = QString("Cannot write '%1': %2").arg(fileName_, file_.errorString());
+        return 0;
+    }
+
+    hashChunks(data, bytesWritten);
+    written_ += bytesWritten;
+
+    if (written_ - committed_ >= commitInterval_ && !commit())
+        return 0;
+
+    return size;
+}
+
+size_t CurlResumableDownload::onHeaderData(char *data, size_t size)
+{
+    QByteArray line = QByteArray::fromRawData(data, static_cast<int>(size)).trimmed();
+    int colon = line.indexOf(':');
+
+    if (line.startsWith("HTTP/")) {
+        // Every response of a redirect chain starts with a status line
+        responseEtag_.clear();
+        responseLastModified_.clear();
+        responseRangeStart_ = -1;
+        responseRangeTotal_ = -1;
+    } else if (colon > 0) {
+        QByteArray name = line.left(colon).trimmed().toLower();
+        QByteArray value = line.mid(colon + 1).trimmed();
+
+        if (name == "etag") {
+            responseEtag_ = value;
+        } else if (name == "last-modified") {
+            responseLastModified_ = value;
+        } else if (name == "content-range" && value.startsWith("bytes ")) {
+            // bytes START-END/TOTAL or bytes */TOTAL
+            QByteArray range = value.mid(6).trimmed();
+            int dash = range.indexOf('-');
+            int slash = range.indexOf('/');
+            bool ok = false;
+
+            if (dash > 0 && dash < slash) {
+                qint64 start = range.left(dash).toLongLong(&ok);
+                if (ok) responseRangeStart_ = start;
+            }
+            if (slash >= 0) {
+                qint64 total = range.mid(slash + 1).toLongLong(&ok);
+                if (ok) responseRangeTotal_ = total;
+            }
+        }
+    }
+
+    if (headerFunction_)
+        return headerFunction_(data, size);
+    else
+        return size;
+}
@@ -0,0 +1,133 @@
+#ifndef CURLRESUMABLEDOWNLOAD_H
+#define CURLRESUMABLEDOWNLOAD_H
+
+#include <curl/curl.h>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QUrl>
+#include "CurlEasy.h"
+
+class QTimer;
+
+// Downloads a URL into a file which survives failures, aborts and crashes.
+//
+// Progress is recorded in a sidecar journal (fileName() + ".journal") holding the number of
+// bytes known to be on disk and the entity validators. Optional per-chunk hashes are
+// appended to fileName() + ".journal.chunks" as chunks complete.
+// perform() continues from the journal with CURLOPT_RESUME_FROM_LARGE and If-Range.
+// If the server entity has changed since, the download starts over and restarted() is emitted.
+// The journal is removed once the download is complete. Only 200 and 206 HTTP responses are
+// written to the file, anything else fails with CURLE_HTTP_RETURNED_ERROR.
+class CurlResumableDownload : public QObject
+{
+    Q_OBJECT
+public:
+    explicit CurlResumableDownload(QObject *parent = nullptr);
+    virtual ~CurlResumableDownload();
+
+    QUrl url() const { return url_; }
+    void setUrl(const QUrl &url) { url_ = url; }
+    QString fileName() const { return fileName_; }
+    void setFileName(const QString &fileName) { fileName_ = fileName; }
+    QString journalFileName() const { return fileName_ + ".journal"; }
+
+    // Chunk hashes let perform() verify bytes on disk before resuming. 0 disables them.
+    // Verification runs in slices from the event loop, the transfer starts once it's done.
+    // Progress is only committed at chunk boundaries when they are enabled.
+    qint64 chunkSize() const { return chunkSize_; }
+    void setChunkSize(qint64 bytes) { chunkSize_ = qMax(qint64(0), bytes); }
+    // How many received bytes may be lost on crash
+    qint64 commitInterval() const { return commitInterval_; }
+    void setCommitInterval(qint64 bytes) { commitInterval_ = qMax(qint64(1), bytes); }
+
+    // Use it for extra options like timeouts, proxies or authentication.
+    // Write function, URL and resume options are managed by CurlResumableDownload.
+    CurlEasy* transfer() { return transfer_; }
+    // Called for every received header line, like CurlEasy::setHeaderFunction
+    void setHeaderFunction(const CurlEasy::DataFunction &function) { headerFunction_ = function; }
+
+    void perform();
+    void abort();
+    bool isRunning() const { return verifying_ || transfer_->isRunning(); }
+    CURLcode result() const { return lastResult_; }
+    QString errorString() const { return errorString_; }
+
+    qint64 bytesWritten() const { return written_; }
+    qint64 bytesCommitted() const { return committed_; }
+    qint64 resumedFrom() const { return resumeFrom_; }
+    qint64 totalSize() const { return totalSize_; } // -1 if unknown
+
+signals:
+    void aborted();
+    void progress(qint64 bytesWritten, qint64 totalSize);
+    void restarted();
+    void done(CURLcode result);
+
+protected:
+    bool openFile(bool resume);
+    void resumeAt(qint64 length);
+    void verifyChunks();
+    void startTransfer();
+    void restart();
+    void finish(CURLcode result, const QString &errorString = QString());
+    bool commit();
+    void resetJournal();
+    bool loadJournal();
+    bool saveJournal();
+    bool saveChunkHashes();
+    QString chunksFileName() const { return journalFileName() + ".chunks"; }
+    bool isHttp() const;
+    void hashChunks(const char *data, qint64 size);
+    bool responseMatchesJournal() const;
+    QByteArray ifRangeValidator() const;
+
+    void onTransferDone(CURLcode result);
+    void onTransferAborted();
+    size_t onWriteData(char *data, size_t size);
+    size_t onHeaderData(char *data, size_t size);
+
+    CurlEasy            *transfer_ = nullptr;
+    QTimer              *verifyTimer_ = nullptr;
+    QUrl                url_;
+    QString             fileName_;
+    QFile               file_;
+    qint64              chunkSize_ = 0;
+    qint64              commitInterval_ = 4*1024*1024;
+    CurlEasy::DataFunction headerFunction_;
+    CURLcode            lastResult_ = CURLE_OK;
+    QString             errorString_;
+
+    // Journal state
+    QByteArray          etag_;
+    QByteArray          lastModified_;
+    qint64              totalSize_ = -1;
+    qint64              committed_ = 0;
+    QList<QByteArray>   chunkHashes_;
+    int                 chunksSaved_ = 0;
+
+    // Verification of bytes on disk
+    bool                verifying_ = false;
+    qint64              verifyLength_ = 0;
+    qint64              verifiedLength_ = 0;
+    QByteArray          verifyBuffer_;
+
+    // Transfer state
+    qint64              resumeFrom_ = 0;
+    qint64              written_ = 0;
+    QCryptographicHash  chunkHash_;
+    bool                bodyChecked_ = false;
+    bool                discardBody_ = false;
+    bool                restartPending_ = false;
+    bool                restarted_ = false;
+
+    // Last response headers
+    QByteArray          responseEtag_;
+    QByteArray          responseLastModified_;
+    qint64              responseRangeStart_ = -1;
+    qint64              responseRangeTotal_ = -1;
+};
+
+#endif // CURLRESUMABLEDOWNLOAD_H
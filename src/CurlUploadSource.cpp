@@ -0,0 +1,156 @@
+#include "CurlUploadSource.h"
+#include <algorithm>
+#include <cstring>
+#include <curl/curl.h>
+
+CurlFileUploadSource::CurlFileUploadSource(const QString &fileName)
+    : file_(fileName)
+{
+    file_.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+}
+
+CurlFileUploadSource::CurlFileUploadSource(int fd, QFileDevice::FileHandleFlags handleFlags)
+{
+    if (file_.open(fd, QIODevice::ReadOnly | QIODevice::Unbuffered, handleFlags))
+        file_.seek(0);
+}
+
+qint64 CurlFileUploadSource::size() const
+{
+    if (!file_.isOpen() || file_.isSequential())
+        return -1;
+    return file_.size();
+}
+
+size_t CurlFileUploadSource::read(char *buffer, size_t size)
+{
+    qint64 bytesRead = file_.read(buffer, static_cast<qint64>(size));
+    if (bytesRead < 0)
+        return CURL_READFUNC_ABORT;
+    return static_cast<size_t>(bytesRead);
+}
+
+bool CurlFileUploadSource::seek(qint64 offset)
+{
+    if (!isSeekable())
+        return false;
+    return file_.seek(offset);
+}
+
+CurlMappedFileUploadSource::CurlMappedFileUploadSource(const QString &fileName)
+    : file_(fileName)
+{
+    if (!file_.open(QIODevice::ReadOnly))
+        return;
+
+    // Zero sized mappings aren't allowed, an empty file just has nothing to read
+    size_ = file_.size();
+    if (size_ > 0)
+        data_ = file_.map(0, size_);
+
+    valid_ = size_ == 0 || data_ != nullptr;
+    if (!valid_)
+        size_ = 0;
+}
+
+CurlMappedFileUploadSource::~CurlMappedFileUploadSource()
+{
+    if (data_)
+        file_.unmap(data_);
+}
+
+size_t CurlMappedFileUploadSource::read(char *buffer, size_t size)
+{
+    if (!isOpen())
+        return CURL_READFUNC_ABORT;
+
+    size_t bytes = static_cast<size_t>(qMin(static_cast<qint64>(size), size_ - pos_));
+    if (bytes > 0) {
+        std::memcpy(buffer, data_ + pos_, bytes);
+        pos_ += static_cast<qint64>(bytes);
+    }
+    return bytes;
+}
+
+bool CurlMappedFileUploadSource::seek(qint64 offset)
+{
+    if (offset < 0 || offset > size_)
+        return false;
+    pos_ = offset;
+    return true;
+}
+
+CurlByteArrayUploadSource::CurlByteArrayUploadSource(const QByteArray &data)
+    : data_(data)
+{
+}
+
+size_t CurlByteArrayUploadSource::read(char *buffer, size_t size)
+{
+    size_t bytes = static_cast<size_t>(qMin(static_cast<qint64>(size), data_.size() - pos_));
+    if (bytes > 0) {
+        std::memcpy(buffer, data_.constData() + pos_, bytes);
+        pos_ += static_cast<qint64>(bytes);
+    }
+    return bytes;
+}
+
+bool CurlByteArrayUploadSource::seek(qint64 offset)
+{
+    if (offset < 0 || offset > data_.size())
+        return false;
+    pos_ = offset;
+    return true;
+}
+
+CurlChainedUploadSource::CurlChainedUploadSource(const QList<QByteArray> &buffers)
+{
+    for (const QByteArray &buffer : buffers)
+        append(buffer);
+}
+
+void CurlChainedUploadSource::append(const QByteArray &buffer)
+{
+    if (buffer.isEmpty())
+        return;
+
+    buffers_.push_back(buffer);
+    offsets_.push_back(size_);
+    size_ += buffer.size();
+}
+
+size_t CurlChainedUploadSource::read(char *buffer, size_t size)
+{
+    size_t bytes = 0;
+
+    // Fill as much of libcurl buffer as possible, crossing buffer boundaries
+    while (bytes < size && current_ < buffers_.size()) {
+        const QByteArray &source = buffers_[current_];
+        qint64 offset = pos_ - offsets_[current_];
+        size_t part = static_cast<size_t>(qMin(static_cast<qint64>(size - bytes), source.size() - offset));
+
+        std::memcpy(buffer + bytes, source.constData() + offset, part);
+        bytes += part;
+        pos_ += static_cast<qint64>(part);
+
+        if (pos_ == offsets_[current_] + source.size())
+            current_++;
+    }
+
+    return bytes;
+}
+
+bool CurlChainedUploadSource::seek(qint64 offset)
+{
+    if (offset < 0 || offset > size_)
+        return false;
+
+    // Last buffer starting at or before offset
+    auto it = std::upper_bound(offsets_.begin(), offsets_.end(), offset);
+    current_ = it == offsets_.begin() ? 0 : static_cast<size_t>(it - offsets_.begin()) - 1;
+    if (offset == size_)
+        current_ = buffers_.size();
+
+    pos_ = offset;
+    return true;
+}
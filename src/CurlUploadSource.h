@@ -0,0 +1,111 @@
+#ifndef CURLUPLOADSOURCE_H
+#define CURLUPLOADSOURCE_H
+
+#include <vector>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+// Upload data for CurlEasy::setUploadSource.
+// libcurl calls read() straight with its own upload buffer, so sources copy
+// data into it exactly once and never allocate on the way.
+class CurlUploadSource
+{
+public:
+    virtual ~CurlUploadSource() {}
+
+    // Total number of bytes, -1 if unknown
+    virtual qint64 size() const = 0;
+    virtual qint64 pos() const = 0;
+    // Returns number of bytes copied into buffer, 0 at end or CURL_READFUNC_ABORT on error
+    virtual size_t read(char *buffer, size_t size) = 0;
+    // Absolute position, used by libcurl to rewind on redirects and auth retries
+    virtual bool seek(qint64 offset) = 0;
+    // libcurl is told it can't seek rather than that seeking failed, so it may work around it
+    virtual bool isSeekable() const { return true; }
+};
+
+// Reads a file from its beginning without QFile buffering in between
+class CurlFileUploadSource : public CurlUploadSource
+{
+public:
+    explicit CurlFileUploadSource(const QString &fileName);
+    explicit CurlFileUploadSource(int fd, QFileDevice::FileHandleFlags handleFlags = QFileDevice::DontCloseHandle);
+
+    bool isOpen() const { return file_.isOpen(); }
+    QString errorString() const { return file_.errorString(); }
+
+    qint64 size() const override;
+    qint64 pos() const override { return file_.pos(); }
+    size_t read(char *buffer, size_t size) override;
+    bool seek(qint64 offset) override;
+    bool isSeekable() const override { return file_.isOpen() && !file_.isSequential(); }
+
+protected:
+    QFile file_;
+};
+
+// Maps the whole file into memory and copies from the mapping
+class CurlMappedFileUploadSource : public CurlUploadSource
+{
+public:
+    explicit CurlMappedFileUploadSource(const QString &fileName);
+    virtual ~CurlMappedFileUploadSource();
+
+    bool isOpen() const { return valid_; }
+    QString errorString() const { return file_.errorString(); }
+
+    qint64 size() const override { return size_; }
+    qint64 pos() const override { return pos_; }
+    size_t read(char *buffer, size_t size) override;
+    bool seek(qint64 offset) override;
+
+protected:
+    QFile   file_;
+    uchar   *data_ = nullptr;
+    bool    valid_ = false;
+    qint64  size_ = 0;
+    qint64  pos_ = 0;
+};
+
+// Uploads a QByteArray without detaching it, so the data is shared rather than copied
+class CurlByteArrayUploadSource : public CurlUploadSource
+{
+public:
+    explicit CurlByteArrayUploadSource(const QByteArray &data);
+
+    qint64 size() const override { return data_.size(); }
+    qint64 pos() const override { return pos_; }
+    size_t read(char *buffer, size_t size) override;
+    bool seek(qint64 offset) override;
+
+protected:
+    const QByteArray    data_;
+    qint64              pos_ = 0;
+};
+
+// Uploads several buffers one after another as a single body
+class CurlChainedUploadSource : public CurlUploadSource
+{
+public:
+    CurlChainedUploadSource() {}
+    explicit CurlChainedUploadSource(const QList<QByteArray> &buffers);
+
+    // Must not be called while the upload is running, size is picked up on next CurlEasy::perform()
+    void append(const QByteArray &buffer);
+
+    qint64 size() const override { return size_; }
+    qint64 pos() const override { return pos_; }
+    size_t read(char *buffer, size_t size) override;
+    bool seek(qint64 offset) override;
+
+protected:
+    std::vector<QByteArray> buffers_;
+    std::vector<qint64>     offsets_; // Start of each buffer in the whole body
+    qint64                  size_ = 0;
+    qint64                  pos_ = 0;
+    size_t                  current_ = 0;
+};
+
+#endif // CURLUPLOADSOURCE_H
@@ -1,9 +1,15 @@
 INCLUDEPATH += $$PWD/
 
 SOURCES += \
+    $$PWD/CurlArena.cpp \
     $$PWD/CurlMulti.cpp \
-    $$PWD/CurlEasy.cpp
+    $$PWD/CurlEasy.cpp \
+    $$PWD/CurlResumableDownload.cpp \
+    $$PWD/CurlUploadSource.cpp
 
 HEADERS += \
+    $$PWD/CurlArena.h \
     $$PWD/CurlMulti.h \
-    $$PWD/CurlEasy.h
+    $$PWD/CurlEasy.h \
+    $$PWD/CurlResumableDownload.h \
+    $$PWD/CurlUploadSource.h